@@ -1,18 +1,56 @@
 /**
  * Simple In-Memory Filesystem using FUSE
  * 
- * This filesystem stores all data in RAM using fixed-size arrays.
+ * This filesystem stores all data in RAM. Names live in fixed-size arrays;
+ * file contents live in chunks whose size adapts to each file (see below).
  * It supports basic operations: creating files/directories, reading, and writing.
  * All data is lost when the filesystem is unmounted.
  * 
  * Limitations:
  * - Maximum 256 files and 256 directories
- * - Maximum 256 bytes per file
+ * - Maximum 4 GiB per file
  * - Flat directory structure (all items in root)
- * - No delete operations
+ * - Files can be deleted, directories cannot (no rmdir)
+ *
+ * Each directory carries recursive subtree statistics (bytes, files,
+ * subdirectories and last change time) which are kept up to date as the
+ * tree changes and exposed as virtual extended attributes, e.g.:
+ *   getfattr -n user.dir.rbytes /mnt
+ *
+ * File contents are split into 2 MiB regions, each made of chunks of its
+ * own size. Files start with 4 KiB pages, which suit small files and random
+ * access; once a file keeps being written sequentially, the regions it
+ * writes use larger extents (up to 2 MiB) so large reads and writes touch
+ * few chunks, and once the writes turn random the regions they touch go
+ * back to pages. Only the regions a write touches are ever converted, so
+ * no single write costs more than repacking two regions. Unwritten chunks
+ * are holes that read as zeros.
+ *
+ * Every operation works on paths alone and no per-open state is kept, so
+ * the filesystem can be mounted with "-o stateless". The kernel then keeps
+ * cached file pages across opens and attribute refreshes, since all changes
+ * come through this filesystem. Where the kernel and libfuse support
+ * zero-message opens, open answers ENOSYS once and the kernel stops sending
+ * open and release requests for files; elsewhere a cached read still costs
+ * those two round trips. Directories are always opened: the high-level
+ * libfuse API keeps its own handle for every open directory and cannot do
+ * without the opendir request.
+ *
+ * FUSE calls the operations from several threads at once. A single
+ * reader-writer lock protects all filesystem state: lookups and reads share
+ * it, anything that changes names, contents or statistics takes it
+ * exclusively. Helper functions assume the caller holds the lock.
+ *
+ * New chunks of every size, from 4 KiB pages to 2 MiB extents, come from
+ * per-CPU pools of chunks that are already faulted in and zeroed, keeping
+ * zeroing and page faults off the path of first writes and appends. A
+ * low-priority background thread tops the pools up, sizes each one to the
+ * allocation rate it has recently seen, and sleeps while nothing is being
+ * allocated.
  */
 
-#define FUSE_USE_VERSION 30
+#define _GNU_SOURCE  /* sched_getcpu(), SCHED_IDLE */
+#define FUSE_USE_VERSION 30  /* libfuse 3 API */
 
 #include <fuse.h>
 #include <stdio.h>
@@ -21,10 +59,61 @@
 #include <time.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* rename() flags, for C libraries that do not define them */
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE      ( 1 << 0 )
+#endif
+
+/* Chunk sizing policy for file contents */
+#define MIN_CHUNK_SIZE        4096            /* Pages for small/random files */
+#define MAX_CHUNK_SIZE        ( 2 << 20 )     /* Extents for large sequential files */
+#define REGION_SIZE           MAX_CHUNK_SIZE  /* Unit in which chunk sizes change */
+#define CHUNK_GROWTH          16              /* Factor between chunk size steps */
+#define PROMOTE_MIN_CHUNKS    4               /* File must span this many bigger chunks */
+#define PROMOTE_SEQ_WRITES    4               /* Sequential writes before growing */
+#define DEMOTE_RANDOM_WRITES  8               /* Random writes before shrinking */
+#define MAX_FILE_SIZE         ( 1LL << 32 )   /* Bounds the region table size */
+
+/* Pre-zeroed chunk pools, one per CPU and chunk size */
+#define MAX_POOLS             64              /* CPUs beyond this share pools */
+#define NR_CHUNK_SIZES        4               /* 4 KiB, 64 KiB, 1 MiB, 2 MiB */
+#define POOL_MIN_BYTES        ( 64 << 10 )    /* Kept even when idle */
+#define POOL_MAX_BYTES        ( 8 << 20 )     /* Most a single pool may hold */
+#define POOL_MAX_PAGES        ( POOL_MAX_BYTES / MIN_CHUNK_SIZE )
+#define POOL_REFILL_US        10000           /* Refill thread period while busy */
+#define POOL_HEADROOM         4               /* Periods of demand to keep ready */
 
 /* ========== Data Structures ========== */
 
+/* Protects everything below; see the locking note at the top of the file */
+pthread_rwlock_t fs_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* Chunks of one size that are faulted in and zeroed, ready for use */
+struct page_pool
+{
+	pthread_mutex_t lock;             /* Taken by writers and the refill thread */
+	size_t chunk_size;                /* Size of every chunk in the pool */
+	char *pages[ POOL_MAX_PAGES ];
+	int count;                        /* Chunks ready in the pool */
+	int target;                       /* Chunks the refill thread aims to keep */
+	int allocs;                       /* Chunks handed out since the last refill */
+};
+
+struct page_pool page_pools[ MAX_POOLS ][ NR_CHUNK_SIZES ];
+int nr_page_pools = 0;  /* 0 until start_page_pools(); chunks are then calloc()ed */
+volatile int page_pools_running = 0;
+pthread_t page_pool_thread;
+
+/* Lets the refill thread sleep while no chunks are being allocated */
+pthread_mutex_t page_pool_wake_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t page_pool_wake = PTHREAD_COND_INITIALIZER;
+int page_pool_idle = 0;
+
 /* Directory storage: up to 256 directories, each name up to 255 chars */
 char dir_list[ 256 ][ 256 ];
 int curr_dir_idx = -1;  /* Index of last directory (-1 means empty) */
@@ -33,26 +122,122 @@ int curr_dir_idx = -1;  /* Index of last directory (-1 means empty) */
 char files_list[ 256 ][ 256 ];
 int curr_file_idx = -1;  /* Index of last file (-1 means empty) */
 
-/* File content storage: up to 256 files, each content up to 255 bytes */
-char files_content[ 256 ][ 256 ];
+/* One REGION_SIZE slice of a file, stored as equally sized chunks */
+struct region
+{
+	char **chunks;        /* Chunk table; NULL entries are holes (read as zeros) */
+	size_t nr_chunks;     /* Number of slots in the chunk table */
+	size_t chunk_size;    /* Size of every chunk, 0 while the region is a hole */
+};
+
+/* Content of a single file; regions may use different chunk sizes */
+struct file_content
+{
+	struct region *regions;  /* Region table; covers the file from offset 0 */
+	size_t nr_regions;    /* Number of slots in the region table */
+	size_t chunk_size;    /* Chunk size for regions written from now on */
+	off_t size;           /* File size in bytes */
+	off_t next_offset;    /* Offset a sequential write would start at */
+	int seq_writes;       /* Consecutive sequential writes */
+	int random_writes;    /* Consecutive non-sequential writes */
+};
+
+/* File content storage: up to 256 files */
+struct file_content files_content[ 256 ];
 int curr_file_content_idx = -1;  /* Index of last file content */
 
+/* Recursive subtree statistics of a directory (CephFS-style "r" stats) */
+struct dir_stats
+{
+	long long rbytes;        /* Total size of all files below the directory */
+	long long rfiles;        /* Number of files below the directory */
+	long long rsubdirs;      /* Number of directories below the directory */
+	struct timespec rctime;  /* Most recent change anywhere below the directory */
+};
+
+/* Statistics of the root directory and of each entry in dir_list */
+struct dir_stats root_stats;
+struct dir_stats dir_stats[ 256 ];
+
+/* Virtual xattrs exposing the statistics, NUL-separated for listxattr */
+static const char dir_xattr_names[] =
+	"user.dir.rbytes\0user.dir.rfiles\0user.dir.rsubdirs\0user.dir.rctime";
+
+/* Mount options understood by this filesystem (on top of FUSE's own) */
+struct lsysfs_options
+{
+	int stateless;  /* -o stateless: skip opens where supported, keep cache */
+};
+
+static struct lsysfs_options options;
+
+static const struct fuse_opt option_spec[] = {
+	{ "stateless", offsetof( struct lsysfs_options, stateless ), 1 },
+	FUSE_OPT_END
+};
+
+/* Set once the kernel agreed to skip open requests for files */
+int no_open_negotiated = 0;
+
 /* ========== Helper Functions ========== */
 
+/**
+ * Get the recursive statistics of a directory
+ * @param path Full path (e.g., "/" or "/dirname")
+ * @return Pointer to the statistics, or NULL if path is not a directory
+ */
+struct dir_stats *get_dir_stats( const char *path )
+{
+	if ( strcmp( path, "/" ) == 0 )
+		return &root_stats;
+	
+	path++;  /* Skip the leading '/' character */
+	
+	for ( int curr_idx = 0; curr_idx <= curr_dir_idx; curr_idx++ )
+		if ( strcmp( path, dir_list[ curr_idx ] ) == 0 )
+			return &dir_stats[ curr_idx ];
+	
+	return NULL;
+}
+
+/**
+ * Fold a change into the statistics of every ancestor directory
+ * The tree is flat, so the parent chain of any entry is just the root and
+ * each change is applied there directly in O(1).
+ * @param bytes Change in total file size
+ * @param files Change in number of files
+ * @param subdirs Change in number of directories
+ */
+void account_change( long long bytes, int files, int subdirs )
+{
+	root_stats.rbytes += bytes;
+	root_stats.rfiles += files;
+	root_stats.rsubdirs += subdirs;
+	clock_gettime( CLOCK_REALTIME, &root_stats.rctime );
+}
+
 /**
  * Add a new directory to the filesystem
  * @param dir_name Name of the directory (without leading '/')
+ * @return 0 on success, -ENOSPC if the directory table is full
  */
-void add_dir( const char *dir_name )
+int add_dir( const char *dir_name )
 {
 	/* Check if we've reached the maximum number of directories */
 	if ( curr_dir_idx >= 255 )
-		return;
+		return -ENOSPC;
 	
 	curr_dir_idx++;
 	/* Use strncpy to prevent buffer overflow */
 	strncpy( dir_list[ curr_dir_idx ], dir_name, 255 );
 	dir_list[ curr_dir_idx ][ 255 ] = '\0';  /* Ensure null termination */
+	
+	/* A new directory is empty; only its change time is meaningful */
+	memset( &dir_stats[ curr_dir_idx ], 0, sizeof( struct dir_stats ) );
+	clock_gettime( CLOCK_REALTIME, &dir_stats[ curr_dir_idx ].rctime );
+	
+	account_change( 0, 0, 1 );
+	return 0;
 }
 
 /**
@@ -75,12 +260,13 @@ int is_dir( const char *path )
 /**
  * Add a new file to the filesystem
  * @param filename Name of the file (without leading '/')
+ * @return 0 on success, -ENOSPC if the file table is full
  */
-void add_file( const char *filename )
+int add_file( const char *filename )
 {
 	/* Check if we've reached the maximum number of files */
 	if ( curr_file_idx >= 255 )
-		return;
+		return -ENOSPC;
 	
 	curr_file_idx++;
 	/* Use strncpy to prevent buffer overflow */
@@ -89,7 +275,11 @@ void add_file( const char *filename )
 	
 	/* Initialize empty content for the new file */
 	curr_file_content_idx++;
-	files_content[ curr_file_content_idx ][ 0 ] = '\0';
+	memset( &files_content[ curr_file_content_idx ], 0, sizeof( struct file_content ) );
+	files_content[ curr_file_content_idx ].chunk_size = MIN_CHUNK_SIZE;
+	
+	account_change( 0, 1, 0 );
+	return 0;
 }
 
 /**
@@ -126,6 +316,552 @@ int get_file_index( const char *path )
 	return -1;  /* File not found */
 }
 
+/**
+ * Get the array index of a directory
+ * @param path Full path (e.g., "/dirname")
+ * @return Index in dir_list array, or -1 if not found
+ */
+int get_dir_index( const char *path )
+{
+	path++;  /* Skip the leading '/' character */
+	
+	for ( int curr_idx = 0; curr_idx <= curr_dir_idx; curr_idx++ )
+		if ( strcmp( path, dir_list[ curr_idx ] ) == 0 )
+			return curr_idx;
+	
+	return -1;  /* Directory not found */
+}
+
+/**
+ * Get the pool index of a chunk size
+ * @param chunk_size One of the chunk sizes used for file contents
+ * @return Index into the second dimension of page_pools
+ */
+int chunk_size_idx( size_t chunk_size )
+{
+	int size_idx = 0;
+	
+	for ( size_t size = MIN_CHUNK_SIZE; size < chunk_size && size_idx < NR_CHUNK_SIZES - 1; size *= CHUNK_GROWTH )
+		size_idx++;
+	
+	return size_idx;
+}
+
+/**
+ * Get a fresh chunk and fault it in, zeroed
+ * @param chunk_size Size of the chunk
+ * @return The chunk, or NULL if out of memory
+ */
+char *new_zeroed_chunk( size_t chunk_size )
+{
+	char *chunk = aligned_alloc( MIN_CHUNK_SIZE, chunk_size );
+	
+	/* Writing the zeros also takes the page faults now rather than later */
+	if ( chunk != NULL )
+		memset( chunk, 0, chunk_size );
+	
+	return chunk;
+}
+
+/**
+ * Wake the refill thread if it is sleeping
+ * Writers only look at the flag without the lock, so an allocation racing
+ * with the thread going to sleep may not wake it; the next one will.
+ */
+void wake_page_pool_worker( void )
+{
+	if ( !__atomic_load_n( &page_pool_idle, __ATOMIC_RELAXED ) )
+		return;
+	
+	pthread_mutex_lock( &page_pool_wake_lock );
+	page_pool_idle = 0;
+	pthread_cond_signal( &page_pool_wake );
+	pthread_mutex_unlock( &page_pool_wake_lock );
+}
+
+/**
+ * Take a zeroed chunk for file contents
+ * Uses the pool of the current CPU for that chunk size, and zeroes a chunk
+ * synchronously only if that pool has run dry.
+ * @param chunk_size Size of the chunk
+ * @return The chunk, or NULL if out of memory
+ */
+char *alloc_chunk( size_t chunk_size )
+{
+	if ( nr_page_pools == 0 )
+		return calloc( 1, chunk_size );
+	
+	int cpu = sched_getcpu();
+	struct page_pool *pool = &page_pools[ ( cpu < 0 ? 0 : cpu ) % nr_page_pools ][ chunk_size_idx( chunk_size ) ];
+	char *chunk = NULL;
+	
+	pthread_mutex_lock( &pool->lock );
+	pool->allocs++;
+	if ( pool->count > 0 )
+		chunk = pool->pages[ --pool->count ];
+	pthread_mutex_unlock( &pool->lock );
+	
+	wake_page_pool_worker();
+	
+	if ( chunk == NULL )
+		chunk = new_zeroed_chunk( chunk_size );
+	
+	return chunk;
+}
+
+/**
+ * Bring one pool to the size its recent allocation rate calls for
+ * The target follows demand up immediately and decays slowly, so a burst
+ * of appends finds the pool full next time without pinning memory forever.
+ * Limits are in bytes, so pools of extents hold few chunks and none at all
+ * until extents are actually being allocated.
+ * @param pool Pool to refill
+ * @return 1 if the pool still needs attention, 0 if it is settled at its
+ *         minimum with no allocations since the last refill
+ */
+int refill_page_pool( struct page_pool *pool )
+{
+	char *spare[ POOL_MAX_PAGES ];
+	int nr_spare = 0;
+	int min_pages = POOL_MIN_BYTES / pool->chunk_size;
+	int max_pages = POOL_MAX_BYTES / pool->chunk_size;
+	
+	pthread_mutex_lock( &pool->lock );
+	
+	int busy = pool->allocs > 0 || pool->target > min_pages || pool->count != pool->target;
+	
+	int target = pool->allocs * POOL_HEADROOM;
+	if ( target < pool->target * 3 / 4 )
+		target = pool->target * 3 / 4;
+	if ( target < min_pages )
+		target = min_pages;
+	if ( target > max_pages )
+		target = max_pages;
+	
+	pool->target = target;
+	pool->allocs = 0;
+	
+	/* Give back chunks the pool no longer needs */
+	while ( pool->count > target )
+		spare[ nr_spare++ ] = pool->pages[ --pool->count ];
+	
+	int missing = target - pool->count;
+	pthread_mutex_unlock( &pool->lock );
+	
+	for ( int i = 0; i < nr_spare; i++ )
+		free( spare[ i ] );
+	nr_spare = 0;
+	
+	/* Zero the new chunks without holding the lock, then hand them over */
+	while ( nr_spare < missing )
+	{
+		char *chunk = new_zeroed_chunk( pool->chunk_size );
+		if ( chunk == NULL )
+			break;
+		spare[ nr_spare++ ] = chunk;
+	}
+	if ( nr_spare == 0 )
+		return busy;
+	
+	pthread_mutex_lock( &pool->lock );
+	while ( nr_spare > 0 && pool->count < max_pages )
+		pool->pages[ pool->count++ ] = spare[ --nr_spare ];
+	pthread_mutex_unlock( &pool->lock );
+	
+	for ( int i = 0; i < nr_spare; i++ )
+		free( spare[ i ] );
+	
+	return busy;
+}
+
+/**
+ * Background thread keeping the chunk pools topped up
+ * Runs at idle priority so it only uses CPU time nothing else wants, and
+ * sleeps until the next allocation once every pool has settled.
+ * @param arg Unused
+ * @return NULL
+ */
+void *page_pool_worker( void *arg )
+{
+	struct sched_param param = { 0 };
+	pthread_setschedparam( pthread_self(), SCHED_IDLE, &param );
+	
+	while ( page_pools_running )
+	{
+		int busy = 0;
+		
+		for ( int pool_idx = 0; pool_idx < nr_page_pools; pool_idx++ )
+			for ( int size_idx = 0; size_idx < NR_CHUNK_SIZES; size_idx++ )
+				busy |= refill_page_pool( &page_pools[ pool_idx ][ size_idx ] );
+		
+		if ( busy )
+		{
+			usleep( POOL_REFILL_US );
+			continue;
+		}
+		
+		pthread_mutex_lock( &page_pool_wake_lock );
+		__atomic_store_n( &page_pool_idle, 1, __ATOMIC_RELAXED );
+		while ( page_pool_idle && page_pools_running )
+			pthread_cond_wait( &page_pool_wake, &page_pool_wake_lock );
+		pthread_mutex_unlock( &page_pool_wake_lock );
+	}
+	
+	return NULL;
+}
+
+/**
+ * Free the chunks left in the first pools of page_pools
+ * @param pools Number of CPUs whose pools to empty
+ */
+void drain_page_pools( int pools )
+{
+	for ( int pool_idx = 0; pool_idx < pools; pool_idx++ )
+		for ( int size_idx = 0; size_idx < NR_CHUNK_SIZES; size_idx++ )
+		{
+			struct page_pool *pool = &page_pools[ pool_idx ][ size_idx ];
+			
+			pthread_mutex_lock( &pool->lock );
+			while ( pool->count > 0 )
+				free( pool->pages[ --pool->count ] );
+			pthread_mutex_unlock( &pool->lock );
+		}
+}
+
+/**
+ * Create the chunk pools of every CPU, fill them and start the refill thread
+ * Chunk allocation falls back to calloc() if the thread cannot be started.
+ */
+void start_page_pools( void )
+{
+	long cpus = sysconf( _SC_NPROCESSORS_CONF );
+	int pools = cpus < 1 ? 1 : cpus > MAX_POOLS ? MAX_POOLS : cpus;
+	
+	for ( int pool_idx = 0; pool_idx < pools; pool_idx++ )
+	{
+		size_t chunk_size = MIN_CHUNK_SIZE;
+		
+		for ( int size_idx = 0; size_idx < NR_CHUNK_SIZES; size_idx++ )
+		{
+			struct page_pool *pool = &page_pools[ pool_idx ][ size_idx ];
+			
+			pthread_mutex_init( &pool->lock, NULL );
+			pool->chunk_size = chunk_size < MAX_CHUNK_SIZE ? chunk_size : MAX_CHUNK_SIZE;
+			pool->count = 0;
+			pool->target = 0;
+			pool->allocs = 0;
+			refill_page_pool( pool );
+			
+			chunk_size *= CHUNK_GROWTH;
+		}
+	}
+	
+	page_pool_idle = 0;
+	page_pools_running = 1;
+	if ( pthread_create( &page_pool_thread, NULL, page_pool_worker, NULL ) != 0 )
+	{
+		page_pools_running = 0;
+		drain_page_pools( pools );
+		pools = 0;
+	}
+	
+	nr_page_pools = pools;
+}
+
+/**
+ * Stop the refill thread and free the chunks left in the pools
+ */
+void stop_page_pools( void )
+{
+	if ( !page_pools_running )
+		return;
+	
+	pthread_mutex_lock( &page_pool_wake_lock );
+	page_pools_running = 0;
+	page_pool_idle = 0;
+	pthread_cond_signal( &page_pool_wake );
+	pthread_mutex_unlock( &page_pool_wake_lock );
+	pthread_join( page_pool_thread, NULL );
+	
+	int pools = nr_page_pools;
+	nr_page_pools = 0;  /* From now on chunks come from calloc() */
+	drain_page_pools( pools );
+}
+
+/**
+ * Free all chunks of a region and turn it back into a hole
+ * @param region Region to release
+ */
+void release_region( struct region *region )
+{
+	for ( size_t chunk_idx = 0; chunk_idx < region->nr_chunks; chunk_idx++ )
+		free( region->chunks[ chunk_idx ] );
+	
+	free( region->chunks );
+	region->chunks = NULL;
+	region->nr_chunks = 0;
+	region->chunk_size = 0;
+}
+
+/**
+ * Free all chunks of a file's content
+ * @param content File content to release
+ */
+void release_content( struct file_content *content )
+{
+	for ( size_t region_idx = 0; region_idx < content->nr_regions; region_idx++ )
+		release_region( &content->regions[ region_idx ] );
+	
+	free( content->regions );
+	content->regions = NULL;
+	content->nr_regions = 0;
+}
+
+/**
+ * Copy data out of a file's content, reading holes as zeros
+ * @param content File content to read from
+ * @param buffer Buffer to fill
+ * @param size Number of bytes to copy (must not go past content->size)
+ * @param offset Starting position in the file
+ */
+void read_content( const struct file_content *content, char *buffer, size_t size, off_t offset )
+{
+	while ( size > 0 )
+	{
+		size_t region_idx = offset / REGION_SIZE;
+		size_t region_off = offset % REGION_SIZE;
+		const struct region *region = NULL;
+		
+		if ( region_idx < content->nr_regions && content->regions[ region_idx ].chunk_size != 0 )
+			region = &content->regions[ region_idx ];
+		
+		/* A whole region can be a hole; otherwise go chunk by chunk */
+		size_t chunk_size = region != NULL ? region->chunk_size : REGION_SIZE;
+		size_t chunk_idx = region_off / chunk_size;
+		size_t chunk_off = region_off % chunk_size;
+		size_t len = chunk_size - chunk_off;
+		if ( len > size )
+			len = size;
+		
+		if ( region != NULL && chunk_idx < region->nr_chunks && region->chunks[ chunk_idx ] != NULL )
+			memcpy( buffer, region->chunks[ chunk_idx ] + chunk_off, len );
+		else
+			memset( buffer, 0, len );
+		
+		buffer += len;
+		offset += len;
+		size -= len;
+	}
+}
+
+/**
+ * Copy data into one region, allocating chunks as needed
+ * @param region Region to write to; its chunk size must be set
+ * @param buffer Data to write
+ * @param size Number of bytes to write (must stay inside the region)
+ * @param region_off Starting position inside the region
+ * @return 0 on success, -ENOMEM if a chunk could not be allocated
+ */
+int write_region( struct region *region, const char *buffer, size_t size, size_t region_off )
+{
+	/* Grow the chunk table to cover the end of the write, doubling it so
+	   appends do not reallocate it every time */
+	size_t needed = ( region_off + size + region->chunk_size - 1 ) / region->chunk_size;
+	if ( needed > region->nr_chunks )
+	{
+		if ( needed < region->nr_chunks * 2 )
+			needed = region->nr_chunks * 2;
+		if ( needed > REGION_SIZE / region->chunk_size )
+			needed = REGION_SIZE / region->chunk_size;
+		
+		char **chunks = realloc( region->chunks, needed * sizeof( char * ) );
+		if ( chunks == NULL )
+			return -ENOMEM;
+		
+		memset( chunks + region->nr_chunks, 0, ( needed - region->nr_chunks ) * sizeof( char * ) );
+		region->chunks = chunks;
+		region->nr_chunks = needed;
+	}
+	
+	while ( size > 0 )
+	{
+		size_t chunk_idx = region_off / region->chunk_size;
+		size_t chunk_off = region_off % region->chunk_size;
+		size_t len = region->chunk_size - chunk_off;
+		if ( len > size )
+			len = size;
+		
+		if ( region->chunks[ chunk_idx ] == NULL )
+		{
+			region->chunks[ chunk_idx ] = alloc_chunk( region->chunk_size );
+			if ( region->chunks[ chunk_idx ] == NULL )
+				return -ENOMEM;
+		}
+		
+		memcpy( region->chunks[ chunk_idx ] + chunk_off, buffer, len );
+		
+		buffer += len;
+		region_off += len;
+		size -= len;
+	}
+	
+	return 0;
+}
+
+/**
+ * Check whether a block of memory is all zeros
+ * @param data Memory to check
+ * @param size Number of bytes to check
+ * @return 1 if every byte is zero, 0 otherwise
+ */
+int is_zero( const char *data, size_t size )
+{
+	for ( size_t idx = 0; idx < size; idx++ )
+		if ( data[ idx ] != 0 )
+			return 0;
+	
+	return 1;
+}
+
+/**
+ * Repack one region into chunks of a different size
+ * Costs at most one region's worth of copying. Zero-filled parts become
+ * holes instead of allocated chunks. On allocation failure the old layout
+ * is kept, since the chunk size is only an optimization.
+ * @param region Region to repack
+ * @param chunk_size New chunk size
+ */
+void convert_region( struct region *region, size_t chunk_size )
+{
+	struct region repacked = { NULL, 0, chunk_size };
+	
+	/* Copy in pieces no larger than either chunk size, so each piece of a
+	   split extent can be checked for zeros on its own */
+	size_t piece = chunk_size < region->chunk_size ? chunk_size : region->chunk_size;
+	
+	for ( size_t chunk_idx = 0; chunk_idx < region->nr_chunks; chunk_idx++ )
+	{
+		const char *chunk = region->chunks[ chunk_idx ];
+		if ( chunk == NULL )
+			continue;
+		
+		for ( size_t chunk_off = 0; chunk_off < region->chunk_size; chunk_off += piece )
+		{
+			if ( is_zero( chunk + chunk_off, piece ) )
+				continue;
+			
+			if ( write_region( &repacked, chunk + chunk_off, piece,
+			                   chunk_idx * region->chunk_size + chunk_off ) != 0 )
+			{
+				release_region( &repacked );
+				return;
+			}
+		}
+	}
+	
+	release_region( region );
+	*region = repacked;
+}
+
+/**
+ * Copy data into a file's content, allocating regions and chunks as needed
+ * Regions the write touches are first converted to the file's current
+ * chunk size. Fresh chunks are zeroed, so any gap before offset reads back
+ * as zeros.
+ * @param content File content to write to
+ * @param buffer Data to write
+ * @param size Number of bytes to write
+ * @param offset Starting position in the file
+ * @return 0 on success, -ENOMEM if a chunk could not be allocated
+ */
+int write_content( struct file_content *content, const char *buffer, size_t size, off_t offset )
+{
+	if ( size == 0 )
+		return 0;
+	
+	/* Grow the region table to cover the end of the write */
+	size_t needed = ( offset + size + REGION_SIZE - 1 ) / REGION_SIZE;
+	if ( needed > content->nr_regions )
+	{
+		if ( needed < content->nr_regions * 2 )
+			needed = content->nr_regions * 2;
+		
+		struct region *regions = realloc( content->regions, needed * sizeof( struct region ) );
+		if ( regions == NULL )
+			return -ENOMEM;
+		
+		memset( regions + content->nr_regions, 0, ( needed - content->nr_regions ) * sizeof( struct region ) );
+		content->regions = regions;
+		content->nr_regions = needed;
+	}
+	
+	while ( size > 0 )
+	{
+		struct region *region = &content->regions[ offset / REGION_SIZE ];
+		size_t region_off = offset % REGION_SIZE;
+		size_t len = REGION_SIZE - region_off;
+		if ( len > size )
+			len = size;
+		
+		if ( region->chunk_size == 0 )
+			region->chunk_size = content->chunk_size;
+		else if ( region->chunk_size != content->chunk_size )
+			convert_region( region, content->chunk_size );
+		
+		int res = write_region( region, buffer, len, region_off );
+		if ( res != 0 )
+			return res;
+		
+		buffer += len;
+		offset += len;
+		size -= len;
+		
+		if ( offset > content->size )
+			content->size = offset;
+	}
+	
+	return 0;
+}
+
+/**
+ * Track a file's write pattern and pick its chunk size from it
+ * Sequential writers of large files move to bigger extents; once writes
+ * turn random the file goes back to pages, so writes into holes allocate
+ * 4 KiB rather than a whole extent. Nothing is copied here: regions take
+ * the new size when a write next touches them.
+ * @param content File content about to be written
+ * @param size Number of bytes about to be written
+ * @param offset Starting position of the write
+ */
+void adapt_chunk_size( struct file_content *content, size_t size, off_t offset )
+{
+	if ( offset == content->next_offset )
+	{
+		content->seq_writes++;
+		content->random_writes = 0;
+	}
+	else
+	{
+		content->random_writes++;
+		content->seq_writes = 0;
+	}
+	content->next_offset = offset + size;
+	
+	off_t end = offset + size;
+	if ( end < content->size )
+		end = content->size;
+	
+	size_t bigger = content->chunk_size * CHUNK_GROWTH;
+	if ( bigger > MAX_CHUNK_SIZE )
+		bigger = MAX_CHUNK_SIZE;
+	
+	if ( content->seq_writes >= PROMOTE_SEQ_WRITES && bigger > content->chunk_size
+	     && end >= (off_t) bigger * PROMOTE_MIN_CHUNKS )
+		content->chunk_size = bigger;
+	else if ( content->random_writes >= DEMOTE_RANDOM_WRITES )
+		content->chunk_size = MIN_CHUNK_SIZE;
+}
+
 /**
  * Write content to a file (simple overwrite, used internally)
  * @param path Full path (e.g., "/filename")
@@ -138,20 +874,106 @@ void write_to_file( const char *path, const char *new_content )
 	if ( file_idx == -1 )  /* File not found */
 		return;
 		
-	/* Use strncpy to prevent buffer overflow */
-	strncpy( files_content[ file_idx ], new_content, 255 ); 
-	files_content[ file_idx ][ 255 ] = '\0';  /* Ensure null termination */
+	struct file_content *content = &files_content[ file_idx ];
+	off_t old_size = content->size;
+	
+	/* Drop the old content before writing the new one */
+	release_content( content );
+	content->size = 0;
+	write_content( content, new_content, strlen( new_content ), 0 );
+	
+	account_change( (long long) content->size - old_size, 0, 0 );
+}
+
+/**
+ * Remove a file from the filesystem and free its content
+ * The last file is moved into the freed slot to keep the arrays dense.
+ * @param file_idx Index of the file in files_list
+ */
+void remove_file( int file_idx )
+{
+	account_change( - (long long) files_content[ file_idx ].size, -1, 0 );
+	release_content( &files_content[ file_idx ] );
+	
+	if ( file_idx != curr_file_idx )
+	{
+		memcpy( files_list[ file_idx ], files_list[ curr_file_idx ], 256 );
+		files_content[ file_idx ] = files_content[ curr_file_idx ];
+	}
+	
+	curr_file_idx--;
+	curr_file_content_idx--;
+}
+
+/**
+ * Remove an (always empty) directory from the filesystem
+ * The last directory is moved into the freed slot to keep the arrays dense.
+ * @param dir_idx Index of the directory in dir_list
+ */
+void remove_dir( int dir_idx )
+{
+	account_change( 0, 0, -1 );
+	
+	if ( dir_idx != curr_dir_idx )
+	{
+		memcpy( dir_list[ dir_idx ], dir_list[ curr_dir_idx ], 256 );
+		dir_stats[ dir_idx ] = dir_stats[ curr_dir_idx ];
+	}
+	
+	curr_dir_idx--;
 }
 
 /* ========== FUSE Callback Functions ========== */
 
+/**
+ * Initialize the connection (called once when the filesystem is mounted)
+ * Starts the page pools here rather than in main(), since FUSE may fork
+ * into the background in between and threads do not survive a fork.
+ * In stateless mode, keep cached pages across opens and mtime changes, and
+ * note whether the kernel offers zero-message opens; if so, do_open answers
+ * ENOSYS and the kernel stops sending opens.
+ * Zero-message opendir is not used: libfuse's high-level readdir looks up
+ * the directory handle its own opendir allocated and would crash without it.
+ * @param conn Connection capabilities offered by the kernel
+ * @param cfg Configuration of the high-level library
+ * @return Private data for the filesystem (unused)
+ */
+static void *do_init( struct fuse_conn_info *conn, struct fuse_config *cfg )
+{
+	start_page_pools();
+	
+	if ( !options.stateless )
+		return NULL;
+	
+	/* getattr reports the current time as mtime, which would otherwise make
+	   the kernel drop a file's cached pages on every attribute refresh */
+	cfg->kernel_cache = 1;
+	conn->want &= ~FUSE_CAP_AUTO_INVAL_DATA;
+	
+	/* Needs no flag in conn->want: answering ENOSYS is the opt-in */
+	if ( conn->capable & FUSE_CAP_NO_OPEN_SUPPORT )
+		no_open_negotiated = 1;
+	
+	return NULL;
+}
+
+/**
+ * Clean up the filesystem (called once when it is unmounted)
+ * @param private_data Value returned by do_init (unused)
+ */
+static void do_destroy( void *private_data )
+{
+	stop_page_pools();
+}
+
 /**
  * Get file/directory attributes (called by stat, ls -l, etc.)
  * @param path Path to the file/directory
  * @param st Stat structure to fill with attributes
+ * @param fi File info (unused; may be NULL)
  * @return 0 on success, -ENOENT if path doesn't exist
  */
-static int do_getattr( const char *path, struct stat *st )
+static int do_getattr( const char *path, struct stat *st, struct fuse_file_info *fi )
 {
 	/* Set ownership to the user who mounted the filesystem */
 	st->st_uid = getuid();
@@ -161,6 +983,9 @@ static int do_getattr( const char *path, struct stat *st )
 	st->st_atime = time( NULL );  /* Last access time */
 	st->st_mtime = time( NULL );  /* Last modification time */
 	
+	int res = 0;
+	pthread_rwlock_rdlock( &fs_lock );
+	
 	/* Check if path is root directory or a created directory */
 	if ( strcmp( path, "/" ) == 0 || is_dir( path ) == 1 )
 	{
@@ -176,17 +1001,18 @@ static int do_getattr( const char *path, struct stat *st )
 		/* Get actual file size from content */
 		int file_idx = get_file_index( path );
 		if ( file_idx != -1 )
-			st->st_size = strlen( files_content[ file_idx ] );
+			st->st_size = files_content[ file_idx ].size;
 		else
 			st->st_size = 0;
 	}
 	else
 	{
 		/* Path doesn't exist */
-		return -ENOENT;
+		res = -ENOENT;
 	}
 	
-	return 0;
+	pthread_rwlock_unlock( &fs_lock );
+	return res;
 }
 
 /**
@@ -196,26 +1022,77 @@ static int do_getattr( const char *path, struct stat *st )
  * @param filler Function to add entries to the buffer
  * @param offset Offset (unused in this implementation)
  * @param fi File info (unused in this implementation)
+ * @param flags Readdir flags (unused; no attributes are returned)
  * @return 0 on success
  */
-static int do_readdir( const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi )
+static int do_readdir( const char *path, void *buffer, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi,
+                       enum fuse_readdir_flags flags )
 {
 	/* Add standard directory entries */
-	filler( buffer, ".", NULL, 0 );   /* Current directory */
-	filler( buffer, "..", NULL, 0 );  /* Parent directory */
+	filler( buffer, ".", NULL, 0, 0 );   /* Current directory */
+	filler( buffer, "..", NULL, 0, 0 );  /* Parent directory */
+	
+	pthread_rwlock_rdlock( &fs_lock );
 	
 	/* Only root directory is supported (flat structure) */
 	if ( strcmp( path, "/" ) == 0 )
 	{
 		/* Add all directories */
 		for ( int curr_idx = 0; curr_idx <= curr_dir_idx; curr_idx++ )
-			filler( buffer, dir_list[ curr_idx ], NULL, 0 );
+			filler( buffer, dir_list[ curr_idx ], NULL, 0, 0 );
 	
 		/* Add all files */
 		for ( int curr_idx = 0; curr_idx <= curr_file_idx; curr_idx++ )
-			filler( buffer, files_list[ curr_idx ], NULL, 0 );
+			filler( buffer, files_list[ curr_idx ], NULL, 0, 0 );
 	}
 	
+	pthread_rwlock_unlock( &fs_lock );
+	return 0;
+}
+
+/**
+ * Open a file (called by open(), cat, etc.)
+ * No per-open state is kept: reads and writes look the file up by path.
+ * @param path Path to the file
+ * @param fi File info (unused; do_init sets kernel_cache in stateless mode)
+ * @return 0 on success, -ENOENT if file doesn't exist, -ENOSYS once the
+ *         kernel agreed to skip opens (it then stops sending them)
+ */
+static int do_open( const char *path, struct fuse_file_info *fi )
+{
+	if ( no_open_negotiated )
+		return -ENOSYS;
+	
+	pthread_rwlock_rdlock( &fs_lock );
+	int exists = is_file( path );
+	pthread_rwlock_unlock( &fs_lock );
+	
+	if ( exists == 0 )
+		return -ENOENT;
+	
+	return 0;
+}
+
+/**
+ * Open a directory (called by ls, opendir(), etc.)
+ * @param path Path to the directory
+ * @param fi File info; cache_readdir is set in stateless mode if supported
+ * @return 0 on success, -ENOENT if directory doesn't exist
+ */
+static int do_opendir( const char *path, struct fuse_file_info *fi )
+{
+	pthread_rwlock_rdlock( &fs_lock );
+	int exists = ( get_dir_stats( path ) != NULL );
+	pthread_rwlock_unlock( &fs_lock );
+	
+	if ( exists == 0 )
+		return -ENOENT;
+	
+#ifdef FUSE_CAP_CACHE_READDIR
+	if ( options.stateless )
+		fi->cache_readdir = 1;
+#endif
+	
 	return 0;
 }
 
@@ -230,26 +1107,35 @@ static int do_readdir( const char *path, void *buffer, fuse_fill_dir_t filler, o
  */
 static int do_read( const char *path, char *buffer, size_t size, off_t offset, struct fuse_file_info *fi )
 {
+	pthread_rwlock_rdlock( &fs_lock );
+	
 	int file_idx = get_file_index( path );
 	
 	/* Check if file exists */
 	if ( file_idx == -1 )
+	{
+		pthread_rwlock_unlock( &fs_lock );
 		return -ENOENT;
+	}
 	
-	char *content = files_content[ file_idx ];
-	int len = strlen( content );
+	struct file_content *content = &files_content[ file_idx ];
 	
 	/* If offset is beyond file length, return 0 (EOF) */
-	if ( offset >= len )
+	if ( offset >= content->size )
+	{
+		pthread_rwlock_unlock( &fs_lock );
 		return 0;
+	}
 	
 	/* Calculate how many bytes to actually read */
-	int bytes_to_read = len - offset;
+	off_t bytes_to_read = content->size - offset;
 	if ( bytes_to_read > size )
 		bytes_to_read = size;  /* Don't read more than requested */
 	
-	/* Copy data to buffer */
-	memcpy( buffer, content + offset, bytes_to_read );
+	/* Copy data to buffer, chunk by chunk */
+	read_content( content, buffer, bytes_to_read, offset );
+	
+	pthread_rwlock_unlock( &fs_lock );
 		
 	return bytes_to_read;  /* Return number of bytes read */
 }
@@ -258,14 +1144,18 @@ static int do_read( const char *path, char *buffer, size_t size, off_t offset, s
  * Create a new directory (called by mkdir)
  * @param path Path for the new directory
  * @param mode Permissions mode (unused - we use 0755)
- * @return 0 on success
+ * @return 0 on success, -EEXIST if the name is taken, -ENOSPC if full
  */
 static int do_mkdir( const char *path, mode_t mode )
 {
-	path++;  /* Skip the leading '/' */
-	add_dir( path );
+	int res = -EEXIST;
+	pthread_rwlock_wrlock( &fs_lock );
 	
-	return 0;
+	if ( is_dir( path ) == 0 && is_file( path ) == 0 )
+		res = add_dir( path + 1 );  /* Skip the leading '/' */
+	
+	pthread_rwlock_unlock( &fs_lock );
+	return res;
 }
 
 /**
@@ -273,14 +1163,101 @@ static int do_mkdir( const char *path, mode_t mode )
  * @param path Path for the new file
  * @param mode Permissions mode (unused - we use 0644)
  * @param rdev Device number (unused for regular files)
- * @return 0 on success
+ * @return 0 on success, -EEXIST if the name is taken, -ENOSPC if full
  */
 static int do_mknod( const char *path, mode_t mode, dev_t rdev )
 {
-	path++;  /* Skip the leading '/' */
-	add_file( path );
+	int res = -EEXIST;
+	pthread_rwlock_wrlock( &fs_lock );
 	
-	return 0;
+	if ( is_dir( path ) == 0 && is_file( path ) == 0 )
+		res = add_file( path + 1 );  /* Skip the leading '/' */
+	
+	pthread_rwlock_unlock( &fs_lock );
+	return res;
+}
+
+/**
+ * Delete a file (called by rm, unlink(), etc.)
+ * @param path Path to the file
+ * @return 0 on success, -EISDIR for a directory, -ENOENT if it doesn't exist
+ */
+static int do_unlink( const char *path )
+{
+	int res = 0;
+	pthread_rwlock_wrlock( &fs_lock );
+	
+	int file_idx = get_file_index( path );
+	if ( file_idx != -1 )
+		remove_file( file_idx );
+	else
+		res = is_dir( path ) ? -EISDIR : -ENOENT;
+	
+	pthread_rwlock_unlock( &fs_lock );
+	return res;
+}
+
+/**
+ * Rename a file or directory (called by mv, rename(), etc.)
+ * An existing target of the same kind is replaced, as rename() requires;
+ * directories are always empty here, so replacing one is always allowed.
+ * @param from Current path
+ * @param to New path
+ * @param flags 0 or RENAME_NOREPLACE; RENAME_EXCHANGE is not supported
+ * @return 0 on success, -ENOENT if from doesn't exist, -EISDIR/-ENOTDIR
+ *         if from and to are of different kinds, -EEXIST if to exists and
+ *         RENAME_NOREPLACE was given, -EINVAL for other flags
+ */
+static int do_rename( const char *from, const char *to, unsigned int flags )
+{
+	int res = 0;
+	pthread_rwlock_wrlock( &fs_lock );
+	
+	int from_file = get_file_index( from );
+	int from_dir = get_dir_index( from );
+	int to_file = get_file_index( to );
+	int to_dir = get_dir_index( to );
+	
+	if ( flags & ~RENAME_NOREPLACE )
+		res = -EINVAL;
+	else if ( from_file == -1 && from_dir == -1 )
+		res = -ENOENT;
+	else if ( ( flags & RENAME_NOREPLACE ) && ( to_file != -1 || to_dir != -1 ) )
+		res = -EEXIST;
+	else if ( strcmp( from, to ) == 0 )
+		res = 0;  /* Renaming onto itself is a no-op */
+	else if ( from_file != -1 && to_dir != -1 )
+		res = -EISDIR;
+	else if ( from_dir != -1 && to_file != -1 )
+		res = -ENOTDIR;
+	else if ( from_file != -1 )
+	{
+		/* Replace the target; removal may move the source to another slot */
+		if ( to_file != -1 )
+		{
+			remove_file( to_file );
+			from_file = get_file_index( from );
+		}
+		
+		strncpy( files_list[ from_file ], to + 1, 255 );
+		files_list[ from_file ][ 255 ] = '\0';  /* Ensure null termination */
+		account_change( 0, 0, 0 );
+	}
+	else
+	{
+		if ( to_dir != -1 )
+		{
+			remove_dir( to_dir );
+			from_dir = get_dir_index( from );
+		}
+		
+		strncpy( dir_list[ from_dir ], to + 1, 255 );
+		dir_list[ from_dir ][ 255 ] = '\0';  /* Ensure null termination */
+		account_change( 0, 0, 0 );
+	}
+	
+	pthread_rwlock_unlock( &fs_lock );
+	return res;
 }
 
 /**
@@ -290,39 +1267,119 @@ static int do_mknod( const char *path, mode_t mode, dev_t rdev )
  * @param size Number of bytes to write
  * @param offset Starting position in the file
  * @param info File info (unused in this implementation)
- * @return Number of bytes written, or -ENOENT if file doesn't exist
+ * @return Number of bytes written, -ENOENT if file doesn't exist,
+ *         -EFBIG past the file size limit, -ENOMEM if out of memory
  */
 static int do_write( const char *path, const char *buffer, size_t size, off_t offset, struct fuse_file_info *info )
 {
+	/* Enforce the file size limit, writing as much as still fits */
+	if ( offset >= MAX_FILE_SIZE )
+		return -EFBIG;
+	if ( offset + (off_t) size > MAX_FILE_SIZE )
+		size = MAX_FILE_SIZE - offset;
+	
+	pthread_rwlock_wrlock( &fs_lock );
+	
 	int file_idx = get_file_index( path );
 	
 	/* Check if file exists */
 	if ( file_idx == -1 )
+	{
+		pthread_rwlock_unlock( &fs_lock );
 		return -ENOENT;
+	}
 	
-	int current_len = strlen( files_content[ file_idx ] );
-	int new_len = offset + size;
+	struct file_content *content = &files_content[ file_idx ];
+	off_t old_size = content->size;
 	
-	/* Enforce 255 byte file size limit */
-	if ( new_len > 255 )
-		new_len = 255;
+	/* Pick the chunk size for this file's access pattern */
+	adapt_chunk_size( content, size, offset );
 	
-	/* If writing beyond current file length, pad with zeros */
-	if ( offset > current_len )
-	{
-		memset( files_content[ file_idx ] + current_len, 0, offset - current_len );
-	}
+	/* Copy data in; a gap past the old end is left as zero-filled chunks */
+	int res = write_content( content, buffer, size, offset );
 	
-	/* Calculate actual bytes to write */
-	int bytes_to_write = new_len - offset;
-	if ( bytes_to_write > 0 )
-	{
-		/* Copy data to file content at specified offset */
-		memcpy( files_content[ file_idx ] + offset, buffer, bytes_to_write );
-		files_content[ file_idx ][ new_len ] = '\0';  /* Null terminate */
-	}
+	account_change( (long long) content->size - old_size, 0, 0 );
+	
+	pthread_rwlock_unlock( &fs_lock );
 	
-	return bytes_to_write > 0 ? bytes_to_write : 0;
+	if ( res != 0 )
+		return res;
+	
+	return size;
+}
+
+/**
+ * Get the value of an extended attribute (called by getfattr, getxattr())
+ * Only directories have attributes: the virtual user.dir.* statistics.
+ * @param path Path to the file/directory
+ * @param name Name of the attribute
+ * @param value Buffer to fill with the value
+ * @param size Size of the buffer, or 0 to query the value length
+ * @return Length of the value, -ENODATA if there is no such attribute,
+ *         -ERANGE if the buffer is too small
+ */
+static int do_getxattr( const char *path, const char *name, char *value, size_t size )
+{
+	char tmp[ 32 ];
+	int len;
+	
+	pthread_rwlock_rdlock( &fs_lock );
+	
+	/* Format the value under the lock, so the statistics are consistent */
+	struct dir_stats *stats = get_dir_stats( path );
+	if ( stats == NULL )
+		len = is_file( path ) ? -ENODATA : -ENOENT;
+	else if ( strcmp( name, "user.dir.rbytes" ) == 0 )
+		len = snprintf( tmp, sizeof( tmp ), "%lld", stats->rbytes );
+	else if ( strcmp( name, "user.dir.rfiles" ) == 0 )
+		len = snprintf( tmp, sizeof( tmp ), "%lld", stats->rfiles );
+	else if ( strcmp( name, "user.dir.rsubdirs" ) == 0 )
+		len = snprintf( tmp, sizeof( tmp ), "%lld", stats->rsubdirs );
+	else if ( strcmp( name, "user.dir.rctime" ) == 0 )
+		len = snprintf( tmp, sizeof( tmp ), "%lld.%09ld", (long long) stats->rctime.tv_sec,
+		                stats->rctime.tv_nsec );  /* Same sec.nsec format as CephFS */
+	else
+		len = -ENODATA;
+	
+	pthread_rwlock_unlock( &fs_lock );
+	
+	if ( len < 0 )
+		return len;
+	
+	/* A zero size asks only for the length of the value */
+	if ( size == 0 )
+		return len;
+	if ( size < (size_t) len )
+		return -ERANGE;
+	
+	memcpy( value, tmp, len );  /* xattr values are not NUL-terminated */
+	return len;
+}
+
+/**
+ * List the extended attributes of a file/directory (called by getfattr -d)
+ * @param path Path to the file/directory
+ * @param list Buffer to fill with NUL-separated attribute names
+ * @param size Size of the buffer, or 0 to query the list length
+ * @return Length of the list, or -ERANGE if the buffer is too small
+ */
+static int do_listxattr( const char *path, char *list, size_t size )
+{
+	pthread_rwlock_rdlock( &fs_lock );
+	int has_stats = ( get_dir_stats( path ) != NULL );
+	int exists = has_stats || is_file( path );
+	pthread_rwlock_unlock( &fs_lock );
+	
+	if ( !has_stats )
+		return exists ? 0 : -ENOENT;  /* Files have no attributes */
+	
+	if ( size == 0 )
+		return sizeof( dir_xattr_names );
+	if ( size < sizeof( dir_xattr_names ) )
+		return -ERANGE;
+	
+	memcpy( list, dir_xattr_names, sizeof( dir_xattr_names ) );
+	return sizeof( dir_xattr_names );
 }
 
 /**
@@ -335,14 +1392,32 @@ static struct fuse_operations operations = {
     .read		= do_read,       /* Read file data */
     .mkdir		= do_mkdir,      /* Create directory */
     .mknod		= do_mknod,      /* Create file */
+    .unlink		= do_unlink,     /* Delete file */
+    .rename		= do_rename,     /* Rename file/directory */
     .write		= do_write,      /* Write file data */
+    .getxattr	= do_getxattr,  /* Get extended attribute */
+    .listxattr	= do_listxattr, /* List extended attributes */
+    .open		= do_open,       /* Open file (stateless) */
+    .opendir	= do_opendir,   /* Open directory (stateless) */
+    .init		= do_init,       /* Negotiate capabilities, start page pools */
+    .destroy	= do_destroy,   /* Stop page pools */
 };
 
 /**
  * Main entry point
- * Initializes FUSE with our operations and starts the filesystem
+ * Parses our own mount options, then initializes FUSE with our operations
+ * and starts the filesystem
  */
 int main( int argc, char *argv[] )
 {
-	return fuse_main( argc, argv, &operations, NULL );
+	struct fuse_args args = FUSE_ARGS_INIT( argc, argv );
+	
+	/* Pick out -o stateless; everything else is passed on to FUSE */
+	if ( fuse_opt_parse( &args, &options, option_spec, NULL ) == -1 )
+		return 1;
+	
+	int ret = fuse_main( args.argc, args.argv, &operations, NULL );
+	
+	fuse_opt_free_args( &args );
+	return ret;
 }
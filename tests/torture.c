@@ -0,0 +1,1004 @@
+/**
+ * Multi-threaded torture and scalability suite for the filesystem engine
+ *
+ * The engine is driven in-process: src/fs.c is compiled into this program
+ * and its FUSE callbacks are called directly, so no mount is needed. The
+ * page pools are started as do_init would, so writes take pooled pages.
+ *
+ * Before both phases, a deterministic single-threaded check writes a file
+ * in known patterns and inspects its chunk layout: the writes at which it
+ * is promoted to bigger chunks and demoted back to pages, which regions are
+ * converted, that zero-filled pieces become holes on conversion, and that
+ * the file reads back exactly across regions of mixed chunk sizes. It runs
+ * once with chunks from calloc() and once from the page pools.
+ *
+ * Phase 1 (scalability): for 1, 2, 4, ... up to the maximum thread count,
+ * all threads run a randomized mix of create, write, append, read, rename,
+ * unlink, readdir and getattr on a shared set of names for a fixed time.
+ * Appends are bursts of large sequential writes that grow files to 2 MiB
+ * extents, and scatters are bursts of small writes at random offsets inside
+ * a file that demote the regions they touch back to pages, so chunk size
+ * changes and every chunk pool run under concurrency. Every
+ * result is checked against what the operation may legally return, and
+ * every read is checked for torn or misplaced data. Once the threads have
+ * stopped, the whole tree is checked against the directory statistics.
+ * Throughput is reported per thread count and a level whose throughput
+ * drops below half of the best level so far is marked as a cliff.
+ *
+ * Phase 2 (linearizability): small groups of threads race on two names
+ * and record each operation's invocation and response on a shared logical
+ * clock. Each sampled history is checked against a sequential reference
+ * model (Wing & Gong search): some order of the operations that respects
+ * real time must explain every result.
+ *
+ * Usage: tests/torture [max_threads] [seconds_per_level] [histories]
+ * Exits with status 1 on the first violation found.
+ */
+
+#define main lsysfs_main
+#include "../src/fs.c"
+#undef main
+
+#include <stdint.h>
+#include <sys/time.h>
+
+/* ========== Configuration ========== */
+
+#define NAMES             192      /* Names used by phase 1 (< file table size) */
+#define BLOCK_SIZE        64       /* Writes and reads cover whole blocks */
+#define MAX_IO_BLOCKS     128      /* Up to 8 KiB per write/read */
+#define MAX_FILE_BLOCKS   262144   /* Keeps files within 16 MiB */
+#define APPEND_IO_BLOCKS  8192     /* 512 KiB per append write */
+#define APPEND_WRITES     16       /* 8 MiB per append burst */
+#define LIN_THREADS       4        /* Threads per linearizability history */
+#define LIN_OPS           4        /* Operations per thread per history */
+#define LIN_MAX_OPS       ( LIN_THREADS * LIN_OPS )
+#define MEMO_SIZE         ( 1 << 16 )
+
+int max_threads = 256;
+double seconds_per_level = 1.0;
+int histories = 2000;
+
+/* ========== Helper Functions ========== */
+
+/**
+ * Report a violation and stop the suite
+ * @param what Description of the violation
+ * @param detail Path or other detail
+ * @param value Offending value
+ */
+void fail( const char *what, const char *detail, long long value )
+{
+	fprintf( stderr, "FAIL: %s (%s, %lld)\n", what, detail, value );
+	exit( 1 );
+}
+
+/**
+ * Get a monotonic timestamp
+ * @return Seconds since an arbitrary point
+ */
+double now( void )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Small per-thread pseudo random number generator (xorshift64)
+ * @param state Generator state, must not be 0
+ * @return Next pseudo random number
+ */
+uint64_t next_rand( uint64_t *state )
+{
+	uint64_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	return *state = x;
+}
+
+/**
+ * Fill one block so that it describes itself: which write produced it and
+ * at which file offset it belongs. A block that does not match its own
+ * header was torn or misplaced.
+ * @param block Block to fill
+ * @param tag Unique, non-zero id of the write
+ * @param offset File offset of the block
+ */
+void fill_block( char *block, uint64_t tag, uint64_t offset )
+{
+	memcpy( block, &tag, 8 );
+	memcpy( block + 8, &offset, 8 );
+	for ( int i = 16; i < BLOCK_SIZE; i++ )
+		block[ i ] = (char) ( tag * 31 + offset + i );
+}
+
+/**
+ * Check one block read back from a file
+ * @param block Block to check
+ * @param offset File offset the block was read from
+ * @return 1 if the block is a hole or intact, 0 otherwise
+ */
+int check_block( const char *block, uint64_t offset )
+{
+	uint64_t tag, stored_offset;
+	memcpy( &tag, block, 8 );
+	memcpy( &stored_offset, block + 8, 8 );
+
+	/* A hole reads as zeros */
+	if ( tag == 0 )
+	{
+		for ( int i = 0; i < BLOCK_SIZE; i++ )
+			if ( block[ i ] != 0 )
+				return 0;
+		return 1;
+	}
+
+	if ( stored_offset != offset )
+		return 0;
+	for ( int i = 16; i < BLOCK_SIZE; i++ )
+		if ( block[ i ] != (char) ( tag * 31 + offset + i ) )
+			return 0;
+
+	return 1;
+}
+
+/* ========== Directory Listing ========== */
+
+/* Names collected by collect_entry */
+struct listing
+{
+	char names[ 512 ][ 256 ];
+	int count;
+};
+
+/**
+ * Filler for do_readdir that collects names into a struct listing
+ */
+static int collect_entry( void *buffer, const char *name, const struct stat *st, off_t off,
+                          enum fuse_fill_dir_flags flags )
+{
+	struct listing *listing = buffer;
+
+	if ( listing->count >= 512 )
+		return 1;
+
+	snprintf( listing->names[ listing->count ], 256, "%s", name );
+	listing->count++;
+
+	return 0;
+}
+
+/**
+ * List the root directory and check that no name appears twice
+ * @param listing Listing to fill
+ */
+void list_root( struct listing *listing )
+{
+	listing->count = 0;
+	if ( do_readdir( "/", listing, collect_entry, 0, NULL, 0 ) != 0 )
+		fail( "readdir of / failed", "/", 0 );
+
+	if ( listing->count > 2 + 256 + 256 )
+		fail( "readdir returned too many entries", "/", listing->count );
+
+	for ( int i = 0; i < listing->count; i++ )
+		for ( int j = i + 1; j < listing->count; j++ )
+			if ( strcmp( listing->names[ i ], listing->names[ j ] ) == 0 )
+				fail( "readdir returned a name twice", listing->names[ i ], j );
+}
+
+/**
+ * Read a numeric statistic of the root directory
+ * @param name Name of the extended attribute
+ * @return Value of the statistic
+ */
+long long root_stat( const char *name )
+{
+	char value[ 32 ];
+	int len = do_getxattr( "/", name, value, sizeof( value ) - 1 );
+
+	if ( len < 0 )
+		fail( "getxattr failed", name, len );
+
+	value[ len ] = '\0';
+	return atoll( value );
+}
+
+/**
+ * Unlink every file in the root directory
+ */
+void remove_all_files( void )
+{
+	static struct listing listing;
+	char path[ 258 ];
+	struct stat st;
+
+	list_root( &listing );
+	for ( int i = 0; i < listing.count; i++ )
+	{
+		snprintf( path, sizeof( path ), "/%s", listing.names[ i ] );
+		if ( do_getattr( path, &st, NULL ) == 0 && S_ISREG( st.st_mode ) )
+			do_unlink( path );
+	}
+}
+
+/**
+ * Check the whole tree while no operation is running: every file reads
+ * back in full, and the root statistics add up
+ * @param blocks 1 if files hold self-describing blocks that must be intact
+ */
+void check_tree( int blocks )
+{
+	static struct listing listing;
+	static char data[ MAX_FILE_BLOCKS * BLOCK_SIZE ];
+	char path[ 258 ];
+	long long files = 0, bytes = 0;
+
+	list_root( &listing );
+	for ( int i = 0; i < listing.count; i++ )
+	{
+		struct stat st;
+
+		if ( strcmp( listing.names[ i ], "." ) == 0 || strcmp( listing.names[ i ], ".." ) == 0 )
+			continue;
+
+		snprintf( path, sizeof( path ), "/%s", listing.names[ i ] );
+		if ( do_getattr( path, &st, NULL ) != 0 )
+			fail( "listed entry has no attributes", path, 0 );
+		if ( !S_ISREG( st.st_mode ) )
+			continue;
+
+		if ( st.st_size > sizeof( data ) || ( blocks && st.st_size % BLOCK_SIZE != 0 ) )
+			fail( "file has an impossible size", path, st.st_size );
+
+		int len = do_read( path, data, sizeof( data ), 0, NULL );
+		if ( len != st.st_size )
+			fail( "full read does not match file size", path, len );
+
+		for ( int off = 0; blocks && off < len; off += BLOCK_SIZE )
+			if ( !check_block( data + off, off ) )
+				fail( "torn or misplaced block", path, off );
+
+		files++;
+		bytes += st.st_size;
+	}
+
+	if ( root_stat( "user.dir.rfiles" ) != files )
+		fail( "user.dir.rfiles does not match the listing", "/", root_stat( "user.dir.rfiles" ) );
+	if ( root_stat( "user.dir.rbytes" ) != bytes )
+		fail( "user.dir.rbytes does not match the file sizes", "/", root_stat( "user.dir.rbytes" ) );
+}
+
+/* ========== Chunk Layout Check ========== */
+
+#define LAYOUT_PATH       "/layout"
+#define LAYOUT_IO         ( 64 << 10 )             /* Sequential write size */
+#define LAYOUT_SIZE       ( 5 * REGION_SIZE )      /* 10 MiB, ends in a 2 MiB extent */
+
+char layout_ref[ LAYOUT_SIZE ];   /* What the file must read back as */
+char layout_data[ LAYOUT_SIZE ];
+
+/**
+ * Get the content of the layout file
+ * @return Its content; fails the suite if the file does not exist
+ */
+struct file_content *layout_content( void )
+{
+	pthread_rwlock_rdlock( &fs_lock );
+	int file_idx = get_file_index( LAYOUT_PATH );
+	pthread_rwlock_unlock( &fs_lock );
+
+	if ( file_idx == -1 )
+		fail( "layout file disappeared", LAYOUT_PATH, 0 );
+
+	return &files_content[ file_idx ];
+}
+
+/**
+ * Write to the layout file and to the reference copy
+ * @param offset Starting position
+ * @param size Number of bytes to write
+ * @param zeros 1 to write zeros, 0 to write a non-zero pattern
+ */
+void layout_write( off_t offset, size_t size, int zeros )
+{
+	for ( size_t i = 0; i < size; i++ )
+		layout_data[ i ] = zeros ? 0 : (char) ( 1 + ( offset + i ) * 131 % 255 );
+	memcpy( layout_ref + offset, layout_data, size );
+
+	if ( do_write( LAYOUT_PATH, layout_data, size, offset, NULL ) != (int) size )
+		fail( "layout write failed", LAYOUT_PATH, offset );
+}
+
+/**
+ * Check the chunk size of one region of the layout file
+ * @param region_idx Region to check
+ * @param chunk_size Expected chunk size
+ */
+void layout_expect_region( size_t region_idx, size_t chunk_size )
+{
+	struct file_content *content = layout_content();
+
+	if ( region_idx >= content->nr_regions || content->regions[ region_idx ].chunk_size != chunk_size )
+		fail( "region has the wrong chunk size", LAYOUT_PATH, region_idx );
+}
+
+/**
+ * Count the chunks of a region of the layout file that are not holes
+ * @param region_idx Region to count
+ * @return Number of allocated chunks
+ */
+int layout_chunks( size_t region_idx )
+{
+	struct region *region = &layout_content()->regions[ region_idx ];
+	int count = 0;
+
+	for ( size_t chunk_idx = 0; chunk_idx < region->nr_chunks; chunk_idx++ )
+		count += region->chunks[ chunk_idx ] != NULL;
+
+	return count;
+}
+
+/**
+ * Check that the layout file reads back as the reference copy, in one
+ * piece and in odd-sized pieces that straddle chunk and region boundaries
+ * @param size Expected file size
+ */
+void layout_check_data( off_t size )
+{
+	if ( do_read( LAYOUT_PATH, layout_data, LAYOUT_SIZE, 0, NULL ) != size )
+		fail( "layout file has the wrong size", LAYOUT_PATH, size );
+	if ( memcmp( layout_data, layout_ref, size ) != 0 )
+		fail( "layout file does not read back as written", LAYOUT_PATH, 0 );
+
+	for ( off_t offset = 0; offset < size; offset += 999983 )
+	{
+		int len = do_read( LAYOUT_PATH, layout_data, 12345, offset, NULL );
+		if ( len < 0 || memcmp( layout_data, layout_ref + offset, len ) != 0 )
+			fail( "partial read does not match what was written", LAYOUT_PATH, offset );
+	}
+}
+
+/**
+ * Run the deterministic chunk layout check on a fresh file
+ */
+void check_chunk_layout( void )
+{
+	memset( layout_ref, 0, sizeof( layout_ref ) );
+	if ( do_mknod( LAYOUT_PATH, S_IFREG | 0644, 0 ) != 0 )
+		fail( "cannot create layout file", LAYOUT_PATH, 0 );
+
+	/* Sequential writes promote the file once it is big enough for
+	   PROMOTE_MIN_CHUNKS of the next size: at 256 KiB, 4 MiB and 8 MiB */
+	for ( int write = 1; write <= LAYOUT_SIZE / LAYOUT_IO; write++ )
+	{
+		layout_write( (off_t) ( write - 1 ) * LAYOUT_IO, LAYOUT_IO, 0 );
+
+		off_t end = (off_t) write * LAYOUT_IO;
+		size_t expected = end >= 8 << 20 ? 2 << 20 : end >= 4 << 20 ? 1 << 20 : end >= 256 << 10 ? 64 << 10 : 4 << 10;
+		if ( layout_content()->chunk_size != expected )
+			fail( "sequential writes promoted at the wrong point", LAYOUT_PATH, end );
+	}
+
+	/* Each region keeps the size it had when last written; the write that
+	   crossed a threshold converted the region it landed in */
+	layout_expect_region( 0, 64 << 10 );
+	layout_expect_region( 1, 1 << 20 );
+	layout_expect_region( 2, 1 << 20 );
+	layout_expect_region( 3, 2 << 20 );
+	layout_expect_region( 4, 2 << 20 );
+	layout_check_data( LAYOUT_SIZE );
+
+	/* Zero most of region 3 and scatter writes over region 4: one random
+	   write short of demotion, the file stays at extents */
+	layout_write( 7 << 20, 512 << 10, 1 );
+	layout_write( 6 << 20, 1 << 20, 1 );
+	for ( int write = 0; write < DEMOTE_RANDOM_WRITES - 3; write++ )
+		layout_write( ( 8 << 20 ) + ( write * 5 % 16 ) * ( 128 << 10 ), 4096, 0 );
+	if ( layout_content()->chunk_size != MAX_CHUNK_SIZE )
+		fail( "random writes demoted too early", LAYOUT_PATH, layout_content()->chunk_size );
+	layout_expect_region( 3, 2 << 20 );
+	layout_check_data( LAYOUT_SIZE );
+
+	/* The next one demotes the file; only region 3, which it lands in, goes
+	   back to pages, and its zeroed first 1.5 MiB become holes */
+	layout_write( ( 6 << 20 ) + 8192, 4096, 0 );
+	if ( layout_content()->chunk_size != MIN_CHUNK_SIZE )
+		fail( "random writes did not demote the file", LAYOUT_PATH, layout_content()->chunk_size );
+	layout_expect_region( 2, 1 << 20 );
+	layout_expect_region( 3, 4 << 10 );
+	layout_expect_region( 4, 2 << 20 );
+	if ( layout_chunks( 3 ) != 1 + ( 512 << 10 ) / MIN_CHUNK_SIZE )
+		fail( "demoted region kept zero pages", LAYOUT_PATH, layout_chunks( 3 ) );
+	layout_check_data( LAYOUT_SIZE );
+
+	/* Rewriting from the start promotes again; region 3 is repacked from
+	   pages to 1 MiB chunks and then to an extent */
+	for ( off_t offset = 0; offset < LAYOUT_SIZE; offset += LAYOUT_IO )
+		layout_write( offset, LAYOUT_IO, 0 );
+	if ( layout_content()->chunk_size != MAX_CHUNK_SIZE )
+		fail( "sequential rewrite did not promote the file", LAYOUT_PATH, layout_content()->chunk_size );
+	layout_expect_region( 3, 2 << 20 );
+	if ( layout_chunks( 3 ) != 1 )
+		fail( "repacked region has the wrong chunks", LAYOUT_PATH, layout_chunks( 3 ) );
+	layout_check_data( LAYOUT_SIZE );
+
+	if ( do_unlink( LAYOUT_PATH ) != 0 )
+		fail( "cannot remove layout file", LAYOUT_PATH, 0 );
+}
+
+/* ========== Phase 1: Randomized Mix and Scalability ========== */
+
+volatile int stop_workers;
+uint64_t next_tag = 1;  /* Shared source of unique write tags */
+
+/* Per-thread state of a phase 1 worker */
+struct worker
+{
+	pthread_t thread;
+	uint64_t rand_state;
+	long long ops;
+	struct listing *listing;  /* Too big for the stack */
+	char *append_data;        /* APPEND_IO_BLOCKS blocks, too big as well */
+	pthread_barrier_t *start;
+};
+
+/**
+ * Append a burst of sequential writes to a file, starting again from the
+ * beginning once the file would grow past MAX_FILE_BLOCKS
+ * @param worker Worker doing the appends
+ * @param path File to append to
+ */
+void append_burst( struct worker *worker, const char *path )
+{
+	struct stat st;
+	int res = do_getattr( path, &st, NULL );
+
+	if ( res == -ENOENT )
+		return;
+	if ( res != 0 || st.st_size % BLOCK_SIZE != 0 )
+		fail( "unexpected getattr result before append", path, res != 0 ? res : st.st_size );
+
+	off_t offset = st.st_size;
+	if ( offset + (off_t) APPEND_WRITES * APPEND_IO_BLOCKS * BLOCK_SIZE > (off_t) MAX_FILE_BLOCKS * BLOCK_SIZE )
+		offset = 0;
+
+	for ( int w = 0; w < APPEND_WRITES; w++ )
+	{
+		uint64_t tag = __atomic_fetch_add( &next_tag, 1, __ATOMIC_RELAXED );
+		for ( int b = 0; b < APPEND_IO_BLOCKS; b++ )
+			fill_block( worker->append_data + b * BLOCK_SIZE, tag, offset + b * BLOCK_SIZE );
+		
+		res = do_write( path, worker->append_data, APPEND_IO_BLOCKS * BLOCK_SIZE, offset, NULL );
+		if ( res == -ENOENT )
+			return;
+		if ( res != APPEND_IO_BLOCKS * BLOCK_SIZE )
+			fail( "unexpected append result", path, res );
+		
+		offset += APPEND_IO_BLOCKS * BLOCK_SIZE;
+	}
+}
+
+/**
+ * Overwrite a file at random offsets within its current size, often enough
+ * in a row for the file to go back to pages
+ * @param worker Worker doing the writes
+ * @param path File to write to
+ * @param data Buffer of MAX_IO_BLOCKS blocks
+ */
+void scatter_burst( struct worker *worker, const char *path, char *data )
+{
+	struct stat st;
+	int res = do_getattr( path, &st, NULL );
+
+	if ( res == -ENOENT )
+		return;
+	if ( res != 0 || st.st_size % BLOCK_SIZE != 0 )
+		fail( "unexpected getattr result before scatter", path, res != 0 ? res : st.st_size );
+	if ( st.st_size < MAX_IO_BLOCKS * BLOCK_SIZE )
+		return;
+
+	for ( int w = 0; w < 2 * DEMOTE_RANDOM_WRITES; w++ )
+	{
+		uint64_t r = next_rand( &worker->rand_state );
+		int blocks = 1 + r % MAX_IO_BLOCKS;
+		off_t offset = (off_t) ( ( r >> 16 ) % ( st.st_size / BLOCK_SIZE - MAX_IO_BLOCKS + 1 ) ) * BLOCK_SIZE;
+		uint64_t tag = __atomic_fetch_add( &next_tag, 1, __ATOMIC_RELAXED );
+
+		for ( int b = 0; b < blocks; b++ )
+			fill_block( data + b * BLOCK_SIZE, tag, offset + b * BLOCK_SIZE );
+
+		res = do_write( path, data, blocks * BLOCK_SIZE, offset, NULL );
+		if ( res == -ENOENT )
+			return;
+		if ( res != blocks * BLOCK_SIZE )
+			fail( "unexpected scatter write result", path, res );
+	}
+}
+
+/**
+ * Run random operations on random names until told to stop, checking
+ * every result for legality
+ * @param arg The struct worker of this thread
+ */
+void *mix_worker( void *arg )
+{
+	struct worker *worker = arg;
+	char data[ MAX_IO_BLOCKS * BLOCK_SIZE ];
+	char path[ 32 ], other[ 32 ];
+
+	pthread_barrier_wait( worker->start );
+
+	while ( !stop_workers )
+	{
+		uint64_t r = next_rand( &worker->rand_state );
+		int op = r % 100;
+		int blocks = 1 + ( r >> 8 ) % MAX_IO_BLOCKS;
+		off_t offset = (off_t) ( ( r >> 16 ) % ( MAX_FILE_BLOCKS - MAX_IO_BLOCKS ) ) * BLOCK_SIZE;
+		struct stat st;
+		int res;
+
+		snprintf( path, sizeof( path ), "/f%d", (int) ( ( r >> 32 ) % NAMES ) );
+
+		if ( op < 15 )
+		{
+			res = do_mknod( path, S_IFREG | 0644, 0 );
+			if ( res != 0 && res != -EEXIST && res != -ENOSPC )
+				fail( "unexpected mknod result", path, res );
+		}
+		else if ( op < 40 )
+		{
+			uint64_t tag = __atomic_fetch_add( &next_tag, 1, __ATOMIC_RELAXED );
+			for ( int b = 0; b < blocks; b++ )
+				fill_block( data + b * BLOCK_SIZE, tag, offset + b * BLOCK_SIZE );
+
+			res = do_write( path, data, blocks * BLOCK_SIZE, offset, NULL );
+			if ( res != blocks * BLOCK_SIZE && res != -ENOENT )
+				fail( "unexpected write result", path, res );
+		}
+		else if ( op < 41 )
+			append_burst( worker, path );
+		else if ( op < 42 )
+			scatter_burst( worker, path, data );
+		else if ( op < 70 )
+		{
+			res = do_read( path, data, blocks * BLOCK_SIZE, offset, NULL );
+			if ( res < 0 && res != -ENOENT )
+				fail( "unexpected read result", path, res );
+			if ( res > blocks * BLOCK_SIZE || ( res > 0 && res % BLOCK_SIZE != 0 ) )
+				fail( "read returned a partial block", path, res );
+
+			for ( int off = 0; off < res; off += BLOCK_SIZE )
+				if ( !check_block( data + off, offset + off ) )
+					fail( "torn or misplaced block", path, offset + off );
+		}
+		else if ( op < 80 )
+		{
+			snprintf( other, sizeof( other ), "/f%d", (int) ( ( r >> 40 ) % NAMES ) );
+			res = do_rename( path, other, 0 );
+			if ( res != 0 && res != -ENOENT )
+				fail( "unexpected rename result", path, res );
+		}
+		else if ( op < 90 )
+		{
+			res = do_unlink( path );
+			if ( res != 0 && res != -ENOENT )
+				fail( "unexpected unlink result", path, res );
+		}
+		else if ( op < 93 )
+			list_root( worker->listing );
+		else
+		{
+			res = do_getattr( path, &st, NULL );
+			if ( res != 0 && res != -ENOENT )
+				fail( "unexpected getattr result", path, res );
+			if ( res == 0 && st.st_size % BLOCK_SIZE != 0 )
+				fail( "file has an impossible size", path, st.st_size );
+		}
+
+		worker->ops++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Run the randomized mix with a given number of threads
+ * @param threads Number of worker threads
+ * @return Operations per second over all threads
+ */
+double run_level( int threads )
+{
+	struct worker *workers = calloc( threads, sizeof( struct worker ) );
+	pthread_barrier_t start;
+	long long ops = 0;
+
+	pthread_barrier_init( &start, NULL, threads + 1 );
+	stop_workers = 0;
+
+	for ( int t = 0; t < threads; t++ )
+	{
+		workers[ t ].rand_state = 0x9e3779b97f4a7c15ULL * ( t + 1 ) + threads;
+		workers[ t ].listing = malloc( sizeof( struct listing ) );
+		workers[ t ].append_data = malloc( APPEND_IO_BLOCKS * BLOCK_SIZE );
+		workers[ t ].start = &start;
+		if ( pthread_create( &workers[ t ].thread, NULL, mix_worker, &workers[ t ] ) != 0 )
+			fail( "cannot create worker thread", "phase 1", t );
+	}
+
+	pthread_barrier_wait( &start );
+	double began = now();
+	while ( now() - began < seconds_per_level )
+		usleep( 10000 );
+	stop_workers = 1;
+
+	for ( int t = 0; t < threads; t++ )
+	{
+		pthread_join( workers[ t ].thread, NULL );
+		free( workers[ t ].listing );
+		free( workers[ t ].append_data );
+		ops += workers[ t ].ops;
+	}
+	double elapsed = now() - began;
+
+	pthread_barrier_destroy( &start );
+	free( workers );
+
+	return ops / elapsed;
+}
+
+/**
+ * Phase 1: scale the thread count up and report throughput
+ */
+void run_scalability( void )
+{
+	double base = 0, best = 0;
+
+	printf( "%8s %14s %9s %11s\n", "threads", "ops/s", "speedup", "efficiency" );
+
+	for ( int threads = 1; threads <= max_threads; threads *= 2 )
+	{
+		remove_all_files();
+
+		double rate = run_level( threads );
+		check_tree( 1 );
+
+		if ( base == 0 )
+			base = rate;
+
+		printf( "%8d %14.0f %8.2fx %10.0f%%%s\n", threads, rate, rate / base,
+		        100 * rate / base / threads, rate < best / 2 ? "  <-- cliff" : "" );
+		fflush( stdout );
+
+		if ( rate > best )
+			best = rate;
+
+		/* Also cover a maximum that is not a power of two */
+		if ( threads < max_threads && threads * 2 > max_threads )
+			threads = max_threads / 2;
+	}
+}
+
+/* ========== Phase 2: Linearizability of Sampled Histories ========== */
+
+/* Operations on the two names of the reference model */
+enum lin_kind { LIN_CREATE, LIN_WRITE, LIN_READ, LIN_RENAME, LIN_UNLINK };
+
+/* One completed operation of a history */
+struct lin_op
+{
+	enum lin_kind kind;
+	int name;            /* 0 or 1; rename moves name to the other one */
+	uint64_t value;      /* Value written, or value read back */
+	int res;             /* Return code (0 for a successful read) */
+	uint64_t invoke;     /* Logical time before the call */
+	uint64_t response;   /* Logical time after the call */
+};
+
+/* State of the reference model: two names, each absent or holding a value */
+struct lin_model
+{
+	int present[ 2 ];
+	uint64_t value[ 2 ];  /* 0 means empty file */
+};
+
+const char *lin_paths[ 2 ] = { "/lin0", "/lin1" };
+uint64_t lin_clock;
+struct lin_op lin_ops[ LIN_MAX_OPS ];
+int lin_count;
+
+/* Per-thread state of a phase 2 worker */
+struct lin_worker
+{
+	pthread_t thread;
+	int id;
+	uint64_t rand_state;
+	pthread_barrier_t *start, *done;
+};
+
+/**
+ * Run one operation on the engine and record it in the history
+ * @param kind Operation to run
+ * @param name Name (0 or 1) to run it on
+ * @param value Value to write (for LIN_WRITE)
+ * @param slot Index in lin_ops to record into
+ */
+void lin_run( enum lin_kind kind, int name, uint64_t value, int slot )
+{
+	struct lin_op *op = &lin_ops[ slot ];
+	const char *path = lin_paths[ name ];
+
+	op->kind = kind;
+	op->name = name;
+	op->value = value;
+	op->invoke = __atomic_fetch_add( &lin_clock, 1, __ATOMIC_SEQ_CST );
+
+	switch ( kind )
+	{
+	case LIN_CREATE:
+		op->res = do_mknod( path, S_IFREG | 0644, 0 );
+		break;
+	case LIN_WRITE:
+		op->res = do_write( path, (const char *) &value, 8, 0, NULL );
+		op->res = op->res == 8 ? 0 : op->res;
+		break;
+	case LIN_READ:
+		op->value = 0;
+		op->res = do_read( path, (char *) &op->value, 8, 0, NULL );
+		if ( op->res != 0 && op->res != 8 && op->res != -ENOENT )
+			fail( "unexpected read size", path, op->res );
+		op->res = op->res >= 0 ? 0 : op->res;
+		break;
+	case LIN_RENAME:
+		op->res = do_rename( path, lin_paths[ !name ], 0 );
+		break;
+	case LIN_UNLINK:
+		op->res = do_unlink( path );
+		break;
+	}
+
+	op->response = __atomic_fetch_add( &lin_clock, 1, __ATOMIC_SEQ_CST );
+}
+
+/**
+ * Apply an operation to the reference model
+ * @param model Model state, updated in place
+ * @param op Operation to apply
+ * @return 1 if the model produces the recorded result, 0 otherwise
+ */
+int lin_apply( struct lin_model *model, const struct lin_op *op )
+{
+	int n = op->name;
+
+	switch ( op->kind )
+	{
+	case LIN_CREATE:
+		if ( model->present[ n ] )
+			return op->res == -EEXIST;
+		model->present[ n ] = 1;
+		model->value[ n ] = 0;
+		return op->res == 0;
+	case LIN_WRITE:
+		if ( !model->present[ n ] )
+			return op->res == -ENOENT;
+		model->value[ n ] = op->value;
+		return op->res == 0;
+	case LIN_READ:
+		if ( !model->present[ n ] )
+			return op->res == -ENOENT;
+		return op->res == 0 && op->value == model->value[ n ];
+	case LIN_RENAME:
+		if ( !model->present[ n ] )
+			return op->res == -ENOENT;
+		model->present[ !n ] = 1;
+		model->value[ !n ] = model->value[ n ];
+		model->present[ n ] = 0;
+		return op->res == 0;
+	case LIN_UNLINK:
+		if ( !model->present[ n ] )
+			return op->res == -ENOENT;
+		model->present[ n ] = 0;
+		return op->res == 0;
+	}
+
+	return 0;
+}
+
+/* Visited (linearized set, model state) pairs of the current search */
+struct lin_memo
+{
+	uint32_t generation;
+	uint32_t done;
+	struct lin_model model;
+};
+
+struct lin_memo lin_memo[ MEMO_SIZE ];
+uint32_t lin_generation;
+
+/**
+ * Remember a search state
+ * @return 1 if the state was already visited, 0 if it is new
+ */
+int lin_seen( uint32_t done, const struct lin_model *model )
+{
+	uint64_t h = done * 0x9e3779b97f4a7c15ULL;
+	h ^= ( model->value[ 0 ] * 2 + model->present[ 0 ] ) * 0xbf58476d1ce4e5b9ULL;
+	h ^= ( model->value[ 1 ] * 2 + model->present[ 1 ] ) * 0x94d049bb133111ebULL;
+
+	for ( uint32_t i = h % MEMO_SIZE;; i = ( i + 1 ) % MEMO_SIZE )
+	{
+		struct lin_memo *memo = &lin_memo[ i ];
+
+		if ( memo->generation != lin_generation )
+		{
+			memo->generation = lin_generation;
+			memo->done = done;
+			memo->model = *model;
+			return 0;
+		}
+		if ( memo->done == done && memcmp( &memo->model, model, sizeof( *model ) ) == 0 )
+			return 1;
+	}
+}
+
+/**
+ * Search for a linearization of the not yet linearized operations
+ * @param done Bit set of operations already linearized
+ * @param model Model state after those operations
+ * @return 1 if a linearization exists, 0 otherwise
+ */
+int lin_search( uint32_t done, struct lin_model model )
+{
+	if ( done == ( 1u << lin_count ) - 1 )
+		return 1;
+	if ( lin_seen( done, &model ) )
+		return 0;
+
+	/* An operation may go next only if none of the others finished before it started */
+	uint64_t first_response = UINT64_MAX;
+	for ( int i = 0; i < lin_count; i++ )
+		if ( !( done & ( 1u << i ) ) && lin_ops[ i ].response < first_response )
+			first_response = lin_ops[ i ].response;
+
+	for ( int i = 0; i < lin_count; i++ )
+	{
+		if ( done & ( 1u << i ) || lin_ops[ i ].invoke > first_response )
+			continue;
+
+		struct lin_model next = model;
+		if ( lin_apply( &next, &lin_ops[ i ] ) && lin_search( done | ( 1u << i ), next ) )
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Run LIN_OPS random operations per history, in lockstep with the others
+ * @param arg The struct lin_worker of this thread
+ */
+void *lin_worker( void *arg )
+{
+	struct lin_worker *worker = arg;
+
+	for ( int h = 0; h < histories; h++ )
+	{
+		pthread_barrier_wait( worker->start );
+
+		for ( int i = 0; i < LIN_OPS; i++ )
+		{
+			uint64_t r = next_rand( &worker->rand_state );
+			uint64_t value = ( (uint64_t) h << 16 ) | ( worker->id << 8 ) | ( i + 1 );
+			lin_run( (enum lin_kind) ( r % 5 ), ( r >> 8 ) % 2, value, worker->id * LIN_OPS + i );
+		}
+
+		pthread_barrier_wait( worker->done );
+	}
+
+	return NULL;
+}
+
+/**
+ * Print a history that could not be linearized
+ */
+void print_history( void )
+{
+	const char *kinds[] = { "create", "write", "read", "rename", "unlink" };
+
+	for ( int i = 0; i < lin_count; i++ )
+		fprintf( stderr, "  [%4llu, %4llu] %-6s %s value=%llx res=%d\n",
+		         (unsigned long long) lin_ops[ i ].invoke, (unsigned long long) lin_ops[ i ].response,
+		         kinds[ lin_ops[ i ].kind ], lin_paths[ lin_ops[ i ].name ],
+		         (unsigned long long) lin_ops[ i ].value, lin_ops[ i ].res );
+}
+
+/**
+ * Phase 2: record and check many short concurrent histories
+ */
+void run_linearizability( void )
+{
+	struct lin_worker workers[ LIN_THREADS ];
+	pthread_barrier_t start, done;
+
+	pthread_barrier_init( &start, NULL, LIN_THREADS + 1 );
+	pthread_barrier_init( &done, NULL, LIN_THREADS + 1 );
+	lin_count = LIN_MAX_OPS;
+
+	for ( int t = 0; t < LIN_THREADS; t++ )
+	{
+		workers[ t ].id = t;
+		workers[ t ].rand_state = 0x2545f4914f6cdd1dULL * ( t + 1 );
+		workers[ t ].start = &start;
+		workers[ t ].done = &done;
+		if ( pthread_create( &workers[ t ].thread, NULL, lin_worker, &workers[ t ] ) != 0 )
+			fail( "cannot create worker thread", "phase 2", t );
+	}
+
+	for ( int h = 0; h < histories; h++ )
+	{
+		/* Every history starts from a known state: both names absent */
+		remove_all_files();
+		struct lin_model initial = { { 0, 0 }, { 0, 0 } };
+
+		pthread_barrier_wait( &start );
+		pthread_barrier_wait( &done );
+
+		lin_generation++;
+		if ( !lin_search( 0, initial ) )
+		{
+			fprintf( stderr, "history %d is not linearizable:\n", h );
+			print_history();
+			fail( "linearizability violation", "phase 2", h );
+		}
+
+		check_tree( 0 );
+	}
+
+	for ( int t = 0; t < LIN_THREADS; t++ )
+		pthread_join( workers[ t ].thread, NULL );
+
+	pthread_barrier_destroy( &start );
+	pthread_barrier_destroy( &done );
+
+	printf( "%d histories of %d operations on %d threads are linearizable\n",
+	        histories, LIN_MAX_OPS, LIN_THREADS );
+}
+
+/**
+ * Main entry point
+ * Runs both phases with the limits given on the command line
+ */
+int main( int argc, char *argv[] )
+{
+	if ( argc > 1 )
+		max_threads = atoi( argv[ 1 ] );
+	if ( argc > 2 )
+		seconds_per_level = atof( argv[ 2 ] );
+	if ( argc > 3 )
+		histories = atoi( argv[ 3 ] );
+
+	if ( max_threads < 1 || max_threads > 1024 || seconds_per_level <= 0 || histories < 1 )
+	{
+		fprintf( stderr, "usage: %s [max_threads (1-1024)] [seconds_per_level] [histories]\n", argv[ 0 ] );
+		return 2;
+	}
+
+	printf( "== chunk layout: with and without page pools ==\n" );
+	check_chunk_layout();
+	start_page_pools();
+	check_chunk_layout();
+	printf( "promotion, demotion, holes and mixed-size regions check out\n" );
+
+	printf( "== scalability: up to %d threads, %.1fs per level ==\n", max_threads, seconds_per_level );
+	run_scalability();
+
+	printf( "== linearizability: %d sampled histories ==\n", histories );
+	run_linearizability();
+
+	stop_page_pools();
+
+	printf( "PASS\n" );
+	return 0;
+}